@@ -0,0 +1,264 @@
+/******************************************************************************
+* peg-bench
+* Times the solver on each board size and distinct starting hole, so
+* changes to the search can be checked for regressions. It links against
+* libpegsolver and times peg_solve() alone, or peg_analyze() with --analyze.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "peg-solver.h"
+
+#define BENCH_DEFAULT_REPS 10
+#define BENCH_DEFAULT_WARMUP 2
+
+/* Monotonic wall clock time in seconds */
+static double wall_time(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+struct bench_options {
+    int min_rows;
+    int max_rows;
+    int n_reps;
+    int n_warmup;
+    int n_threads;
+    int move_order;
+    const char *order_name;
+    int json;
+    int analyze;                    /* Time peg_analyze() along random games instead */
+};
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* Returns 1 if no rotation or reflection takes hole to a lower numbered one */
+static int is_distinct_start(const peg_ctx *ctx, int hole) {
+    peg_state_t canonical = peg_canonical(ctx, peg_start_state(ctx, hole));
+
+    for (int k = 0; k < hole; k++) {
+        if (peg_canonical(ctx, peg_start_state(ctx, k)) == canonical) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Times n_reps solves from one starting hole, after n_warmup untimed ones.
+ * Every solve starts from an empty transposition table so the runs are
+ * comparable. Fills times[] with the wall time of each rep in seconds and
+ * *nodes with the states expanded per solve, and returns 1 if the board is
+ * solvable from the hole. */
+static int bench_start(peg_ctx *ctx, int hole, int n_warmup, int n_reps, double *times, unsigned long *nodes) {
+    peg_state_t init_bs = peg_start_state(ctx, hole);
+    unsigned long hits;
+    double start;
+    int ret = 0;
+
+    for (int i = 0; i < n_warmup + n_reps; i++) {
+        peg_clear(ctx);
+        start = wall_time();
+        ret = peg_solve(ctx, init_bs, NULL) >= 0;
+        if (i >= n_warmup) {
+            times[i - n_warmup] = wall_time() - start;
+        }
+
+        /* Every state the search expands misses the table first */
+        peg_tt_stats(ctx, &hits, nodes);
+    }
+    return ret;
+}
+
+/* Times peg_analyze() as a front end would call it: once on the starting
+ * state with an empty memo, its cold time in *cold, then on every state of
+ * n_reps games of random legal moves, after n_warmup untimed games. Fills
+ * times[] with the wall time of each call after the first in seconds, and
+ * returns how many there are. */
+static int bench_analyze(peg_ctx *ctx, int hole, int n_warmup, int n_reps, double *times, double *cold) {
+    struct peg_move_info *moves = malloc(peg_max_moves(ctx) * sizeof(struct peg_move_info));
+    unsigned int seed = (unsigned int)hole;
+    peg_state_t state;
+    int n_times = 0;
+    double start;
+    int n;
+
+    peg_clear(ctx);
+    start = wall_time();
+    peg_analyze(ctx, peg_start_state(ctx, hole), moves);
+    *cold = wall_time() - start;
+
+    for (int i = 0; i < n_warmup + n_reps; i++) {
+        state = peg_start_state(ctx, hole);
+        do {
+            start = wall_time();
+            n = peg_analyze(ctx, state, moves);
+            if (i >= n_warmup) {
+                times[n_times++] = wall_time() - start;
+            }
+            if (n > 0) {
+                int src, mid, dest;
+
+                peg_decode_move(moves[rand_r(&seed) % n].move, &src, &mid, &dest);
+                state ^= ((peg_state_t)1 << src) | ((peg_state_t)1 << mid) | ((peg_state_t)1 << dest);
+            }
+        } while (n > 0);
+    }
+    free(moves);
+    return n_times;
+}
+
+/* The nearest-rank percentile of sorted[] */
+static double percentile(const double *sorted, int n, double p) {
+    int rank = (int)ceil(p / 100.0 * n);
+
+    if (rank < 1) {
+        rank = 1;
+    }
+    return sorted[rank - 1];
+}
+
+static void usage(void) {
+    fprintf(stderr, "Usage: ./peg-bench [--rows N|MIN-MAX] [--reps N] [--warmup N] [--threads N] [--order ORDER]\n");
+    fprintf(stderr, "                   [--analyze] [--json]\n");
+    fprintf(stderr, "--rows picks the board sizes to time (default 4-6, range %d-%d)\n", PEG_MIN_ROWS, PEG_MAX_ROWS);
+    fprintf(stderr, "--reps times N solves of each start (default %d)\n", BENCH_DEFAULT_REPS);
+    fprintf(stderr, "--warmup runs N untimed solves first (default %d)\n", BENCH_DEFAULT_WARMUP);
+    fprintf(stderr, "--threads N searches with N threads (0 uses every core)\n");
+    fprintf(stderr, "--order ORDER tries moves in ORDER: table (default), center, isolated or history\n");
+    fprintf(stderr, "--analyze times peg_analyze() on every state of N random games from each start\n");
+    fprintf(stderr, "--json prints the results as JSON\n");
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    struct bench_options opt = { 4, 6, BENCH_DEFAULT_REPS, BENCH_DEFAULT_WARMUP, 1, PEG_ORDER_TABLE, "table", 0, 0 };
+    int first = 1;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--rows") == 0 && i + 1 < argc) {
+            i++;
+            if (sscanf(argv[i], "%d-%d", &opt.min_rows, &opt.max_rows) != 2) {
+                opt.max_rows = opt.min_rows;
+            }
+        }
+        else if (strcmp(argv[i], "--reps") == 0 && i + 1 < argc) {
+            opt.n_reps = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+            opt.n_warmup = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            opt.n_threads = atoi(argv[++i]);
+            if (opt.n_threads == 0) {
+                opt.n_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+            }
+        }
+        else if (strcmp(argv[i], "--order") == 0 && i + 1 < argc) {
+            opt.order_name = argv[++i];
+            opt.move_order = peg_move_order_from_name(opt.order_name);
+        }
+        else if (strcmp(argv[i], "--analyze") == 0) {
+            opt.analyze = 1;
+        }
+        else if (strcmp(argv[i], "--json") == 0) {
+            opt.json = 1;
+        }
+        else {
+            usage();
+        }
+    }
+
+    if (opt.min_rows < PEG_MIN_ROWS || opt.max_rows > PEG_MAX_ROWS || opt.min_rows > opt.max_rows ||
+        opt.n_reps < 1 || opt.n_warmup < 0 || opt.n_threads < 1 || opt.move_order < 0) {
+        fprintf(stderr, "Error: Argument invalid.\n");
+        usage();
+    }
+
+    /* A game makes fewer moves than the board has holes */
+    double *times = malloc(opt.n_reps * (opt.analyze ? PEG_MAX_NODES : 1) * sizeof(double));
+
+    if (opt.json) {
+        printf("{\n  \"reps\": %d,\n  \"warmup\": %d,\n  \"threads\": %d,\n  \"order\": \"%s\",\n  \"results\": [",
+               opt.n_reps, opt.n_warmup, opt.n_threads, opt.order_name);
+    }
+    else {
+        printf("%d reps after %d warm-up runs, %d thread(s), %s move order\n\n", opt.n_reps, opt.n_warmup,
+               opt.n_threads, opt.order_name);
+        printf(opt.analyze ? "rows  hole     cold us       calls   median us      p99 us\n" :
+                             "rows  hole  solved       nodes   median us      p99 us     nodes/s\n");
+    }
+
+    for (int n_rows = opt.min_rows; n_rows <= opt.max_rows; n_rows++) {
+        peg_ctx *ctx = peg_create(n_rows);
+
+        peg_set_threads(ctx, opt.n_threads);
+        peg_set_move_order(ctx, opt.move_order);
+        for (int hole = 0; hole < peg_n_nodes(ctx); hole++) {
+            unsigned long nodes = 0;
+            int ret;
+
+            if (!is_distinct_start(ctx, hole)) {
+                continue;
+            }
+            if (opt.analyze) {
+                double cold;
+                int n_calls = bench_analyze(ctx, hole, opt.n_warmup, opt.n_reps, times, &cold);
+
+                qsort(times, n_calls, sizeof(double), cmp_double);
+                double median = percentile(times, n_calls, 50.0);
+                double p99 = percentile(times, n_calls, 99.0);
+
+                if (opt.json) {
+                    printf("%s\n    { \"rows\": %d, \"hole\": %d, \"cold_us\": %.3f, \"calls\": %d, "
+                           "\"median_us\": %.3f, \"p99_us\": %.3f }",
+                           first ? "" : ",", n_rows, hole, cold * 1e6, n_calls, median * 1e6, p99 * 1e6);
+                }
+                else {
+                    printf("%4d  %4d %11.3f %11d %11.3f %11.3f\n",
+                           n_rows, hole, cold * 1e6, n_calls, median * 1e6, p99 * 1e6);
+                }
+                fflush(stdout);
+                first = 0;
+                continue;
+            }
+            ret = bench_start(ctx, hole, opt.n_warmup, opt.n_reps, times, &nodes);
+
+            qsort(times, opt.n_reps, sizeof(double), cmp_double);
+            double median = percentile(times, opt.n_reps, 50.0);
+            double p99 = percentile(times, opt.n_reps, 99.0);
+            double rate = median > 0.0 ? nodes / median : 0.0;
+
+            if (opt.json) {
+                printf("%s\n    { \"rows\": %d, \"hole\": %d, \"solved\": %s, \"nodes\": %lu, "
+                       "\"median_us\": %.3f, \"p99_us\": %.3f, \"nodes_per_sec\": %.0f }",
+                       first ? "" : ",", n_rows, hole, ret ? "true" : "false", nodes,
+                       median * 1e6, p99 * 1e6, rate);
+            }
+            else {
+                printf("%4d  %4d  %-6s %11lu %11.3f %11.3f %11.0f\n",
+                       n_rows, hole, ret ? "yes" : "no", nodes, median * 1e6, p99 * 1e6, rate);
+            }
+            fflush(stdout);
+            first = 0;
+        }
+
+        peg_destroy(ctx);
+    }
+
+    if (opt.json) {
+        printf("\n  ]\n}\n");
+    }
+    free(times);
+    return 0;
+}
@@ -0,0 +1,1226 @@
+/******************************************************************************
+* peg-solver
+* libpegsolver: solves the peg game described in
+* https://github.com/chrisdana/watch-peg-game with peg positions ordered from
+* top to bottom, left to right (shown below). Game boards with 4 to 15 rows
+* are supported, as are other boards (see peg-board.inc). See peg-solver.h
+* for the API.
+*
+*                 0
+*              1     2
+*           3     4      5
+*        6     7      8     9
+*     10    11    12    13    14
+*  15    16    17    18    19    20
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+# include <math.h>
+
+#include "peg-solver.h"
+
+#define MAX_NEIGHBORS 6
+#define EMPTY -1
+
+#define MIN_ROWS PEG_MIN_ROWS
+#define MAX_ROWS PEG_MAX_ROWS
+#define MAX_NODES PEG_MAX_NODES  /* MAX_ROWS * (MAX_ROWS + 1) / 2 */
+
+/* Boards up to this size index the transposition table directly by state */
+#define TT_DIRECT_MAX_NODES 21
+/* Larger boards hash states into buckets of one cache line, so a probe
+ * touches one line however full the table is */
+#define TT_BUCKET_BYTES 64
+#define TT_HASH_INIT_BUCKETS (1 << 12)
+/* Cap on a hashed table, and on the counting memo, unless --tt-mb sets one */
+#define TT_DEFAULT_MB 256
+
+/* Plies at the top of a threaded search that are split into tasks */
+#define SPLIT_DEPTH 4
+
+/* Nodes a threaded worker searches between offers to hand off work */
+#define ITER_SLICE 4096
+
+#define MEMO_INIT_SIZE (1 << 16)
+/* Slots past where a state hashes to that the memo looks in */
+#define MEMO_MAX_PROBES 16
+
+/* Endgame databases hold a bit for every state, 32 MiB for 28 holes */
+#define DB_MAX_NODES 28
+#define DB_MAGIC "PEGDB02"
+
+/* Transposition table caches (--cache). The digits are the format version. */
+#define CACHE_MAGIC "PEGTT02"
+
+/* Checkpoints of long searches (--checkpoint), and the seconds between the
+ * snapshots of a table unless --checkpoint-secs sets them */
+#define CKPT_MAGIC "PEGCK02"
+#define CKPT_DEFAULT_SECS 60
+
+/* States the breadth-first search expands per kernel call */
+#define BFS_BLOCK 256
+/* States each rank of a distributed search expands between exchanges */
+#define DIST_BLOCK (1 << 14)
+
+/* Arena blocks start on cache lines, and arenas are sized in huge pages */
+#define ARENA_ALIGN 64
+#define ARENA_HUGE_PAGE ((size_t)1 << 21)
+/* Transparent huge pages only pay for themselves on big arrays; below this
+ * offset, faulting in 2 MiB at a time costs more than the TLB misses saved */
+#define ARENA_HUGE_FROM ((size_t)64 << 20)
+
+/* Largest batch of queries read at once by --serve */
+#define SERVE_BUF_SIZE (1 << 16)
+
+/* Output buffered before each write, and the header of --format binary */
+#define OUT_BUF_SIZE (1 << 16)
+#define OUT_MAGIC "PEGOUT1"
+
+/* Nodes with more legal moves than this share the last branching bucket */
+#define STATS_MAX_BRANCHING 24
+
+/* The holes a legal jump goes through, whatever the board state type */
+struct jump_nodes {
+    int src;
+    int mid;
+    int dest;
+};
+
+/* Header of an endgame database file. One bit per board state follows it,
+ * set if the state can be reduced to a single peg. */
+struct db_header {
+    char magic[8];
+    uint64_t board_key;             /* board_key() of the board it was built for */
+    uint32_t n_rows;
+    uint32_t n_nodes;
+    uint64_t n_solvable;
+};
+
+/* An endgame database mapped into memory */
+struct peg_db {
+    void *map;
+    size_t map_size;
+    const struct db_header *header;
+    const uint8_t *bits;
+    unsigned long lookups;
+};
+
+/* A bump allocator for the large, short lived arrays of the layered searches
+ * and the database build. Its whole cap is reserved as address space up
+ * front but only backed by memory as it is touched, on huge pages where the
+ * system has them, so the newest block can grow in place and a whole layer
+ * is freed by moving one offset back. An arena belongs to one thread. */
+struct peg_arena {
+    char *base;
+    size_t cap;
+    size_t used;
+    size_t peak;
+};
+
+/* Header of a transposition table cache file. The table's storage follows
+ * it exactly as it is laid out in memory, so loading it is one mmap. */
+struct cache_header {
+    char magic[8];
+    uint64_t board_key;             /* board_key() of the board it was built for */
+    uint32_t state_bytes;           /* Size of the board state type */
+    uint32_t n_nodes;
+    uint32_t mask;                  /* 0 for a direct table, else that of the hashed buckets */
+    uint32_t n_keys;
+    uint64_t n_bytes;               /* Size of the storage */
+    uint64_t reserved[3];           /* Keeps the buckets aligned to cache lines */
+};
+
+/* A cache file mapped copy on write: the table goes on changing it in
+ * memory without touching the file */
+struct peg_cache {
+    void *map;
+    size_t map_size;
+    const struct cache_header *header;
+    void *storage;
+};
+
+/* What a checkpoint holds after its header */
+enum ckpt_kind {
+    CKPT_LAYER,                     /* A rank's share of a breadth-first layer: its states */
+    CKPT_TABLE,                     /* The transposition table of a search: its storage */
+    CKPT_MEMO                       /* The counting memo: its entries, packed */
+};
+
+/* Header of a checkpoint file. Each rank writes its checkpoints to two files
+ * in turn, so a crash while writing one leaves the one before. */
+struct ckpt_header {
+    char magic[8];
+    uint64_t board_key;             /* board_key() of the board it was built for */
+    uint32_t state_bytes;
+    uint32_t kind;                  /* An enum ckpt_kind */
+    uint32_t n_ranks;               /* Ranks in the job, and which one wrote it */
+    uint32_t rank;
+    uint32_t seq;                   /* Checkpoints written before this one */
+    uint32_t hole;                  /* CKPT_LAYER: the starting hole searched from */
+    uint32_t n_pegs;                /* CKPT_LAYER: pegs of each state */
+    uint32_t mask;                  /* CKPT_TABLE: 0 if the bits of a direct table follow, else the
+                                     * mask of the hashed table whose keys follow, packed */
+    uint32_t n_keys;                /* CKPT_TABLE: keys that follow */
+    uint32_t reserved;
+    uint64_t n_bytes;               /* Of what follows */
+    uint64_t n_reached;             /* CKPT_LAYER: by all ranks, from hole, in the layers before */
+    uint64_t peak;                  /* CKPT_LAYER: largest layer of all ranks before */
+};
+
+/* A checkpoint to write: its header, and what follows */
+struct ckpt_job {
+    const char *path;
+    const struct board_graph *g;
+    struct ckpt_header h;
+    const void *body;
+    uint32_t seq;                   /* Of the next checkpoint of this rank */
+};
+
+/* Writes checkpoints on a thread of its own, so a search only stops to hand
+ * one over. Jobs are handed over with ckpt_submit(), and tick(), if set, is
+ * run on the thread every interval seconds to take a snapshot itself or to
+ * ask the search for one. */
+struct peg_ckpt {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;            /* Signaled when a job is handed over, is done, or on quit */
+    const char *path;
+    int (*write)(void *job);        /* Writes a job, returning 0 on success */
+    void *job;                      /* The job being written, or NULL */
+    int (*tick)(void *arg);         /* Returns 0 on success */
+    void *tick_arg;
+    int interval;
+    int quit;
+    int failed;                     /* A write or tick failed */
+};
+
+/* Hot path counters of one search. They are only compiled in with PEG_STATS,
+ * and each thread counts into its own search context. */
+struct peg_stats {
+    unsigned long nodes[MAX_NODES];                     /* Nodes visited by depth */
+    unsigned long branching[STATS_MAX_BRANCHING + 1];   /* Nodes by legal moves */
+    unsigned long moves_generated;
+    unsigned long moves_tried;
+};
+
+/* The recursive search is kept as the reference the iterative one must
+ * match, and is used instead of it with PEG_RECURSIVE */
+#ifdef PEG_RECURSIVE
+#define PEG_RECURSIVE_ENABLED 1
+#else
+#define PEG_RECURSIVE_ENABLED 0
+#endif
+
+#ifdef PEG_STATS
+#define STATS_ENABLED 1
+#define STATS_ADD(srch, counter, n) ((srch)->stats.counter += (n))
+#else
+#define STATS_ENABLED 0
+#define STATS_ADD(srch, counter, n) ((void)0)
+#endif
+
+#include "peg-board.inc"
+
+/* Inside the solver a move is the index of its jump in the board's jump
+ * table, where its masks are; making it is one xor with the jump's flip mask.
+ * There are at most MAX_NODES * MAX_NEIGHBORS jumps. */
+typedef uint16_t move_t;
+
+/* The holes of a jump packed into one int, a byte each, which is how moves
+ * leave the library */
+static int enc_move(int src, int mid, int dest) {
+    return src | (mid << 8) | (dest << 16);
+}
+
+static void dec_move(int move, int *src, int *mid, int *dest) {
+    *src = move & 0xff;
+    *mid = (move >> 8) & 0xff;
+    *dest = move >> 16;
+}
+
+/* Mixes the bits of a key (the MurmurHash3 finalizer) */
+static uint64_t hash64(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+/* Writes the decimal digits of a count into buf, which must hold 40 chars */
+static char *format_count(peg_count_t count, char *buf) {
+    char *p = buf + 39;
+
+    *p = '\0';
+    do {
+        *--p = (char)('0' + (int)(count % 10));
+        count /= 10;
+    } while (count != 0);
+    return p;
+}
+
+/* Monotonic wall clock time in seconds */
+static double wall_time(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Buffered output of results, formatted by hand rather than with printf. Full
+ * blocks go straight to the file descriptor, after flushing stdout so that
+ * nothing printed before is overtaken. */
+struct peg_out {
+    int fd;
+    int binary;                     /* --format binary */
+    int quiet;                      /* Leave out board dumps */
+    size_t len;
+    char buf[OUT_BUF_SIZE];
+};
+
+static struct peg_out *out_create(int fd, const struct peg_options *opt) {
+    struct peg_out *o = malloc(sizeof(struct peg_out));
+
+    o->fd = fd;
+    o->binary = opt->output == PEG_OUTPUT_BINARY;
+    o->quiet = opt->quiet;
+    o->len = 0;
+    return o;
+}
+
+static void out_flush(struct peg_out *o) {
+    size_t done = 0;
+
+    fflush(stdout);
+    while (done < o->len) {
+        ssize_t n = write(o->fd, o->buf + done, o->len - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            /* The reader went away; there is no one left to tell */
+            break;
+        }
+        done += (size_t)n;
+    }
+    o->len = 0;
+}
+
+static void out_destroy(struct peg_out *o) {
+    out_flush(o);
+    free(o);
+}
+
+/* Returns room for n more bytes, which must be at most OUT_BUF_SIZE, for the
+ * caller to fill and then add to o->len */
+static char *out_reserve(struct peg_out *o, size_t n) {
+    if (OUT_BUF_SIZE - o->len < n) {
+        out_flush(o);
+    }
+    return o->buf + o->len;
+}
+
+static void out_bytes(struct peg_out *o, const void *p, size_t n) {
+    while (n > 0) {
+        size_t chunk = n < OUT_BUF_SIZE ? n : OUT_BUF_SIZE;
+        memcpy(out_reserve(o, chunk), p, chunk);
+        o->len += chunk;
+        p = (const char *)p + chunk;
+        n -= chunk;
+    }
+}
+
+static void out_str(struct peg_out *o, const char *s) {
+    out_bytes(o, s, strlen(s));
+}
+
+static void out_char(struct peg_out *o, char c) {
+    *out_reserve(o, 1) = c;
+    o->len++;
+}
+
+/* Writes n spaces */
+static void out_pad(struct peg_out *o, int n) {
+    for (int i = 0; i < n; i++) {
+        out_char(o, ' ');
+    }
+}
+
+/* Writes the decimal digits of n, which must not be negative */
+static void out_uint(struct peg_out *o, unsigned n) {
+    char digits[10];
+    int len = 0;
+    char *p;
+
+    do {
+        digits[len++] = (char)('0' + n % 10);
+        n /= 10;
+    } while (n != 0);
+    p = out_reserve(o, len);
+    for (int i = 0; i < len; i++) {
+        p[i] = digits[len - 1 - i];
+    }
+    o->len += len;
+}
+
+/* Writes n 7 bits at a time from the lowest, with the top bit of each byte
+ * set if more follow (LEB128) */
+static void out_varint(struct peg_out *o, peg_state_t n) {
+    char *p = out_reserve(o, (8 * sizeof(peg_state_t) + 6) / 7);
+    size_t len = 0;
+
+    while (n >= 0x80) {
+        p[len++] = (char)((n & 0x7f) | 0x80);
+        n >>= 7;
+    }
+    p[len++] = (char)n;
+    o->len += len;
+}
+
+#ifdef PEG_STATS
+static void stats_merge(struct peg_stats *to, const struct peg_stats *from) {
+    for (int i = 0; i < MAX_NODES; i++) {
+        to->nodes[i] += from->nodes[i];
+    }
+    for (int i = 0; i <= STATS_MAX_BRANCHING; i++) {
+        to->branching[i] += from->branching[i];
+    }
+    to->moves_generated += from->moves_generated;
+    to->moves_tried += from->moves_tried;
+}
+#endif
+
+/* Prints what the search from one starting hole did. Without PEG_STATS only
+ * the time and transposition table counts are known, and stats is NULL. */
+static void print_stats(int hole, int solved, double seconds, unsigned long tt_hits,
+                        unsigned long tt_misses, const struct peg_stats *stats) {
+    printf("Statistics for peg %d removed: %s in %.6f s\n", hole, solved ? "solved" : "unsolved", seconds);
+    printf("  Transposition table: %lu hits, %lu misses\n", tt_hits, tt_misses);
+    if (stats == NULL) {
+        printf("  (Configure with -DPEG_STATS=ON for the search counters)\n\n");
+        return;
+    }
+
+    printf("  Moves generated: %lu, tried: %lu (%.1f%%)\n", stats->moves_generated, stats->moves_tried,
+           stats->moves_generated ? (100.0 * stats->moves_tried / stats->moves_generated) : 0.0);
+    printf("  Nodes visited by depth:");
+    for (int i = 0; i < MAX_NODES; i++) {
+        if (stats->nodes[i]) {
+            printf(" %d:%lu", i, stats->nodes[i]);
+        }
+    }
+    printf("\n  Nodes expanded by legal moves:");
+    for (int i = 0; i <= STATS_MAX_BRANCHING; i++) {
+        if (stats->branching[i]) {
+            printf(" %d%s:%lu", i, (i == STATS_MAX_BRANCHING) ? "+" : "", stats->branching[i]);
+        }
+    }
+    printf("\n\n");
+}
+
+static void print_json_counts(FILE *f, const unsigned long *counts, int n) {
+    fprintf(f, "[");
+    for (int i = 0; i < n; i++) {
+        fprintf(f, i ? ", %lu" : "%lu", counts[i]);
+    }
+    fprintf(f, "]");
+}
+
+/* Writes the same report as one element of the JSON "starts" array */
+static void print_stats_json(FILE *f, int first, int hole, int solved, double seconds,
+                             unsigned long tt_hits, unsigned long tt_misses, const struct peg_stats *stats) {
+    fprintf(f, "%s\n    { \"hole\": %d, \"solved\": %s, \"seconds\": %.6f, \"tt_hits\": %lu, \"tt_misses\": %lu",
+            first ? "" : ",", hole, solved ? "true" : "false", seconds, tt_hits, tt_misses);
+    if (stats != NULL) {
+        int depth = MAX_NODES;
+        while (depth > 0 && stats->nodes[depth - 1] == 0) {
+            depth--;
+        }
+        fprintf(f, ", \"moves_generated\": %lu, \"moves_tried\": %lu, \"nodes_by_depth\": ",
+                stats->moves_generated, stats->moves_tried);
+        print_json_counts(f, stats->nodes, depth);
+        fprintf(f, ", \"branching\": ");
+        print_json_counts(f, stats->branching, STATS_MAX_BRANCHING + 1);
+    }
+    fprintf(f, " }");
+}
+
+/* Identifies a board by its lattice and the lattice points of its holes,
+ * from which everything the solver keeps about it follows */
+static uint64_t board_key(const struct board_graph *g) {
+    uint64_t key = hash64(((uint64_t)g->lattice << 32) | (uint64_t)g->n_nodes);
+
+    for (int n = 0; n < g->n_nodes; n++) {
+        key = hash64(key ^ (((uint64_t)(uint8_t)g->row[n] << 8) | (uint8_t)g->col[n]));
+    }
+    return key;
+}
+
+static size_t db_n_bytes(int n_nodes) {
+    return ((size_t)1 << n_nodes) / 8;
+}
+
+static int db_get(const uint8_t *bits, uint64_t state) {
+    return (bits[state >> 3] >> (state & 7)) & 1;
+}
+
+static void db_set(uint8_t *bits, uint64_t state) {
+    bits[state >> 3] |= (uint8_t)(1u << (state & 7));
+}
+
+/* Writes a database built for board g to path. Returns 0 on success. */
+static int db_write(const char *path, const struct board_graph *g, const uint8_t *bits, uint64_t n_solvable) {
+    struct db_header header;
+    size_t n_bytes = db_n_bytes(g->n_nodes);
+    FILE *f = fopen(path, "wb");
+
+    if (f == NULL) {
+        return -1;
+    }
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DB_MAGIC, sizeof(DB_MAGIC));
+    header.board_key = board_key(g);
+    header.n_rows = (uint32_t)g->n_rows;
+    header.n_nodes = (uint32_t)g->n_nodes;
+    header.n_solvable = n_solvable;
+
+    if (fwrite(&header, sizeof(header), 1, f) != 1 || fwrite(bits, 1, n_bytes, f) != n_bytes) {
+        fclose(f);
+        return -1;
+    }
+    return fclose(f);
+}
+
+/* Maps the database at path, which must have been built for board g.
+ * Returns 0 on success, or prints why not and returns -1. */
+static int db_open(struct peg_db *db, const char *path, const struct board_graph *g) {
+    size_t n_bytes = db_n_bytes(g->n_nodes);
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+
+    memset(db, 0, sizeof(*db));
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "Error: Could not open %s.\n", path);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    if ((size_t)st.st_size != sizeof(struct db_header) + n_bytes) {
+        fprintf(stderr, "Error: %s is not a database for this board.\n", path);
+        close(fd);
+        return -1;
+    }
+
+    db->map_size = (size_t)st.st_size;
+    db->map = mmap(NULL, db->map_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (db->map == MAP_FAILED) {
+        fprintf(stderr, "Error: Could not map %s.\n", path);
+        return -1;
+    }
+
+    db->header = db->map;
+    db->bits = (const uint8_t *)db->map + sizeof(struct db_header);
+    if (memcmp(db->header->magic, DB_MAGIC, sizeof(DB_MAGIC)) != 0 || db->header->board_key != board_key(g) ||
+        db->header->n_rows != (uint32_t)g->n_rows || db->header->n_nodes != (uint32_t)g->n_nodes) {
+        fprintf(stderr, "Error: %s is not a database for this board.\n", path);
+        munmap(db->map, db->map_size);
+        return -1;
+    }
+    return 0;
+}
+
+static void db_close(struct peg_db *db) {
+    if (db->map != NULL) {
+        munmap(db->map, db->map_size);
+    }
+}
+
+/* Reserves an arena of mem_mb MiB, or of the machine's memory if mem_mb is 0.
+ * Pages from the hugetlbfs pool are only used if it can back the whole cap,
+ * since running out of them later would fault; otherwise the kernel is asked
+ * for transparent huge pages past ARENA_HUGE_FROM. */
+static void arena_init(struct peg_arena *a, int mem_mb) {
+    size_t cap = mem_mb > 0 ? (size_t)mem_mb << 20 : (size_t)sysconf(_SC_PHYS_PAGES) * (size_t)sysconf(_SC_PAGESIZE);
+
+    a->cap = (cap + ARENA_HUGE_PAGE - 1) & ~(ARENA_HUGE_PAGE - 1);
+    a->used = 0;
+    a->peak = 0;
+#ifdef MAP_HUGETLB
+    a->base = mmap(NULL, a->cap, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (a->base != MAP_FAILED) {
+        return;
+    }
+#endif
+    a->base = mmap(NULL, a->cap, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (a->base == MAP_FAILED) {
+        fprintf(stderr, "Error: Could not reserve %zu MiB for the search.\n", a->cap >> 20);
+        exit(1);
+    }
+#ifdef MADV_HUGEPAGE
+    if (a->cap > ARENA_HUGE_FROM) {
+        madvise(a->base + ARENA_HUGE_FROM, a->cap - ARENA_HUGE_FROM, MADV_HUGEPAGE);
+    }
+#endif
+}
+
+static void arena_destroy(struct peg_arena *a) {
+    if (a->base != NULL) {
+        munmap(a->base, a->cap);
+        a->base = NULL;
+    }
+}
+
+/* Makes the block at offset off n bytes long. Whatever was allocated after
+ * it is given up. */
+static void *arena_resize_at(struct peg_arena *a, size_t off, size_t n) {
+    if (n > a->cap - off) {
+        fprintf(stderr, "Error: The search needs more than %zu MiB (see --mem-mb).\n", a->cap >> 20);
+        exit(1);
+    }
+    a->used = off + n;
+    if (a->used > a->peak) {
+        a->peak = a->used;
+    }
+    return a->base + off;
+}
+
+/* Returns a new block of n bytes on top of the arena. It is not zeroed. */
+static void *arena_alloc(struct peg_arena *a, size_t n) {
+    return arena_resize_at(a, (a->used + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1), n);
+}
+
+/* Grows or shrinks p, which must be the newest block still in use, to n
+ * bytes in place. Blocks allocated after it are given up. */
+static void *arena_resize(struct peg_arena *a, void *p, size_t n) {
+    return arena_resize_at(a, (size_t)((char *)p - a->base), n);
+}
+
+/* Frees every block from offset mark (an earlier a->used) on */
+static void arena_reset(struct peg_arena *a, size_t mark) {
+    a->used = mark;
+}
+
+/* Gives the memory above the blocks in use back to the system */
+static void arena_trim(struct peg_arena *a) {
+    size_t keep = (a->used + ARENA_HUGE_PAGE - 1) & ~(ARENA_HUGE_PAGE - 1);
+
+    if (keep < a->peak) {
+        madvise(a->base + keep, a->peak - keep, MADV_DONTNEED);
+        a->peak = keep;
+    }
+}
+
+/* Mask of the most buckets a hashed transposition table of at most tt_mb
+ * MiB has, or TT_DEFAULT_MB if tt_mb is 0 */
+static uint32_t tt_max_mask(int tt_mb) {
+    size_t cap = ((size_t)(tt_mb > 0 ? tt_mb : TT_DEFAULT_MB) << 20) / TT_BUCKET_BYTES;
+    uint32_t mask = 0;
+
+    while (((size_t)mask + 1) * 2 <= cap && mask < UINT32_MAX >> 1) {
+        mask = (mask << 1) | 1;
+    }
+    return mask;
+}
+
+/* Maps the cache at path if it was written for board g with states of
+ * state_bytes bytes. Returns 0, or -1 if there is no such cache, which only
+ * means starting with an empty table. */
+static int cache_open(struct peg_cache *c, const char *path, const struct board_graph *g, size_t state_bytes) {
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+
+    memset(c, 0, sizeof(*c));
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct cache_header)) {
+        close(fd);
+        return -1;
+    }
+
+    c->map_size = (size_t)st.st_size;
+    c->map = mmap(NULL, c->map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (c->map == MAP_FAILED) {
+        c->map = NULL;
+        return -1;
+    }
+
+    c->header = c->map;
+    c->storage = (char *)c->map + sizeof(struct cache_header);
+    if (memcmp(c->header->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 || c->header->board_key != board_key(g) ||
+        c->header->state_bytes != state_bytes || c->header->n_nodes != (uint32_t)g->n_nodes ||
+        c->header->n_bytes != c->map_size - sizeof(struct cache_header)) {
+        munmap(c->map, c->map_size);
+        c->map = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+/* Replaces the file at path with head_bytes of head followed by body_bytes
+ * of body, atomically: the file is written under a temporary name and renamed
+ * over the old one, so readers see the old file or the new one, never part of
+ * either. Returns 0 on success. */
+static int write_atomic(const char *path, const void *head, size_t head_bytes, const void *body, size_t body_bytes) {
+    size_t tmp_len = strlen(path) + 32;
+    char *tmp = malloc(tmp_len);
+    const char *p;
+    size_t left;
+    int fd;
+    int ret = -1;
+
+    snprintf(tmp, tmp_len, "%s.tmp.%ld", path, (long)getpid());
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        free(tmp);
+        return -1;
+    }
+
+    for (int part = 0; part < 2; part++) {
+        p = part == 0 ? head : body;
+        left = part == 0 ? head_bytes : body_bytes;
+        while (left > 0) {
+            ssize_t n = write(fd, p, left);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                goto fail;
+            }
+            p += n;
+            left -= (size_t)n;
+        }
+    }
+    if (fsync(fd) == 0 && close(fd) == 0) {
+        fd = -1;
+        ret = rename(tmp, path);
+    }
+
+fail:
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (ret != 0) {
+        unlink(tmp);
+    }
+    free(tmp);
+    return ret;
+}
+
+/* Replaces the cache at path with a table's storage (see write_atomic()) */
+static int cache_write(const char *path, const struct board_graph *g, size_t state_bytes, uint32_t mask,
+                       uint32_t n_keys, const void *storage, size_t n_bytes) {
+    struct cache_header header;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.board_key = board_key(g);
+    header.state_bytes = (uint32_t)state_bytes;
+    header.n_nodes = (uint32_t)g->n_nodes;
+    header.mask = mask;
+    header.n_keys = n_keys;
+    header.n_bytes = n_bytes;
+    return write_atomic(path, &header, sizeof(header), storage, n_bytes);
+}
+
+static void cache_close(struct peg_cache *c) {
+    if (c->map != NULL) {
+        munmap(c->map, c->map_size);
+    }
+}
+
+/* The file that slot (0 or 1) of the checkpoint of rank rank goes in,
+ * path.RANK.SLOT, to be freed */
+static char *ckpt_name(const char *path, int rank, unsigned slot) {
+    size_t len = strlen(path) + 32;
+    char *name = malloc(len);
+
+    snprintf(name, len, "%s.%d.%u", path, rank, slot);
+    return name;
+}
+
+/* Reads n bytes from fd, or fails */
+static int read_all(int fd, void *p, size_t n) {
+    while (n > 0) {
+        ssize_t got = read(fd, p, n);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return -1;
+        }
+        p = (char *)p + got;
+        n -= (size_t)got;
+    }
+    return 0;
+}
+
+/* Reads slot of the checkpoint of rank rank of n_ranks, if it holds kind for
+ * board g with states of state_bytes bytes. The header goes in *h, and what
+ * follows it in body if that is not NULL. Returns 0, or -1 if there is no
+ * such checkpoint or it was cut short. */
+static int ckpt_read(const char *path, int rank, int n_ranks, unsigned slot, const struct board_graph *g,
+                     size_t state_bytes, enum ckpt_kind kind, struct ckpt_header *h, void *body) {
+    char *name = ckpt_name(path, rank, slot);
+    int fd = open(name, O_RDONLY);
+    struct stat st;
+    int ret = -1;
+
+    free(name);
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, &st) == 0 && read_all(fd, h, sizeof(*h)) == 0 &&
+        memcmp(h->magic, CKPT_MAGIC, sizeof(CKPT_MAGIC)) == 0 && h->board_key == board_key(g) &&
+        h->state_bytes == state_bytes && h->kind == (uint32_t)kind && h->n_ranks == (uint32_t)n_ranks &&
+        h->rank == (uint32_t)rank && (uint64_t)st.st_size == sizeof(*h) + h->n_bytes) {
+        ret = body == NULL ? 0 : read_all(fd, body, h->n_bytes);
+    }
+    close(fd);
+    return ret;
+}
+
+/* Writes h->n_bytes of body to slot h->seq % 2 of the checkpoint of rank
+ * h->rank, filling in the magic and board key of *h (see write_atomic()) */
+static int ckpt_write(const char *path, const struct board_graph *g, struct ckpt_header *h, const void *body) {
+    char *name = ckpt_name(path, (int)h->rank, h->seq % 2);
+    int ret;
+
+    memcpy(h->magic, CKPT_MAGIC, sizeof(CKPT_MAGIC));
+    h->board_key = board_key(g);
+    ret = write_atomic(name, h, sizeof(*h), body, h->n_bytes);
+    free(name);
+    return ret;
+}
+
+/* Writes a struct ckpt_job as the next checkpoint of its rank */
+static int ckpt_job_write(void *job) {
+    struct ckpt_job *j = job;
+
+    j->h.seq = j->seq++;
+    return ckpt_write(j->path, j->g, &j->h, j->body);
+}
+
+static void *ckpt_main(void *arg) {
+    struct peg_ckpt *c = arg;
+    struct timespec due;
+    int ret;
+
+    clock_gettime(CLOCK_REALTIME, &due);
+    due.tv_sec += c->interval;
+    pthread_mutex_lock(&c->lock);
+    while (c->job != NULL || !c->quit) {
+        if (c->job != NULL) {
+            pthread_mutex_unlock(&c->lock);
+            ret = c->write(c->job);
+            pthread_mutex_lock(&c->lock);
+            c->failed |= ret != 0;
+            c->job = NULL;
+            pthread_cond_broadcast(&c->cond);
+        }
+        else if (c->tick == NULL) {
+            pthread_cond_wait(&c->cond, &c->lock);
+        }
+        else if (pthread_cond_timedwait(&c->cond, &c->lock, &due) == ETIMEDOUT) {
+            pthread_mutex_unlock(&c->lock);
+            ret = c->tick(c->tick_arg);
+            pthread_mutex_lock(&c->lock);
+            c->failed |= ret != 0;
+            clock_gettime(CLOCK_REALTIME, &due);
+            due.tv_sec += c->interval;
+        }
+    }
+    pthread_mutex_unlock(&c->lock);
+    return NULL;
+}
+
+/* Starts the thread that writes the checkpoints at path. write or tick may
+ * be NULL. */
+static void ckpt_start(struct peg_ckpt *c, const char *path, int (*write)(void *job), int (*tick)(void *arg),
+                       void *tick_arg, int interval) {
+    memset(c, 0, sizeof(*c));
+    c->path = path;
+    c->write = write;
+    c->tick = tick;
+    c->tick_arg = tick_arg;
+    c->interval = interval > 0 ? interval : CKPT_DEFAULT_SECS;
+    pthread_mutex_init(&c->lock, NULL);
+    pthread_cond_init(&c->cond, NULL);
+    pthread_create(&c->thread, NULL, ckpt_main, c);
+}
+
+static void ckpt_check(struct peg_ckpt *c, int failed) {
+    if (failed) {
+        fprintf(stderr, "Error: Could not write the checkpoint %s.\n", c->path);
+        exit(1);
+    }
+}
+
+/* Waits for the job being written, if any, to be done. Exits if a
+ * checkpoint could not be written. */
+static void ckpt_wait(struct peg_ckpt *c) {
+    int failed;
+
+    pthread_mutex_lock(&c->lock);
+    while (c->job != NULL) {
+        pthread_cond_wait(&c->cond, &c->lock);
+    }
+    failed = c->failed;
+    pthread_mutex_unlock(&c->lock);
+    ckpt_check(c, failed);
+}
+
+/* Hands job over to be written once the one before is done. It must not
+ * change until ckpt_wait() returns. */
+static void ckpt_submit(struct peg_ckpt *c, void *job) {
+    ckpt_wait(c);
+    pthread_mutex_lock(&c->lock);
+    c->job = job;
+    pthread_cond_broadcast(&c->cond);
+    pthread_mutex_unlock(&c->lock);
+}
+
+/* Writes what was handed over and ends the thread */
+static void ckpt_stop(struct peg_ckpt *c) {
+    pthread_mutex_lock(&c->lock);
+    c->quit = 1;
+    pthread_cond_broadcast(&c->cond);
+    pthread_mutex_unlock(&c->lock);
+    pthread_join(c->thread, NULL);
+    pthread_cond_destroy(&c->cond);
+    pthread_mutex_destroy(&c->lock);
+    ckpt_check(c, c->failed);
+}
+
+#define PEG_CAT_(a, b) a##b
+#define PEG_CAT(a, b) PEG_CAT_(a, b)
+
+#ifdef PEG_GEN_TABLES
+/* Build-time generator: writes the jump tables of every specialized board as
+ * a C header, so the specialized searches see them as constants */
+int main(void) {
+    struct jump_nodes jumps[MAX_NODES * MAX_NEIGHBORS];
+    struct board_graph g;
+
+    printf("/* Generated by peg-gen-tables. Do not edit. */\n");
+    for (int n_rows = 4; n_rows <= 6; n_rows++) {
+        gen_triangle_graph(&g, n_rows);
+        int n_jumps = gen_jumps(&g, jumps);
+
+        printf("\n#define JT_R%d_N_JUMPS %d\n", n_rows, n_jumps);
+        printf("static const struct jump_32 jt_r%d[JT_R%d_N_JUMPS] = {\n", n_rows, n_rows);
+        for (int i = 0; i < n_jumps; i++) {
+            const struct jump_nodes *j = &jumps[i];
+            printf("    { 0x%06xu, 0x%06xu, 0x%06x },\n",
+                   (1u << j->src) | (1u << j->mid), 1u << j->dest, enc_move(j->src, j->mid, j->dest));
+        }
+        printf("};\n");
+    }
+    return 0;
+}
+#else
+/* Indexed by enum peg_move_order */
+static const char *const move_order_names[PEG_N_ORDERS] = { "table", "center", "isolated", "history" };
+
+/* The library calls of one board state type, which take and return states
+ * widened to peg_state_t */
+struct peg_ops {
+    void *(*create)(const struct board_graph *g);
+    void (*destroy)(void *impl);
+    void (*set_threads)(void *impl, int n_threads);
+    void (*set_move_order)(void *impl, int order);
+    int (*open_db)(void *impl, const char *path);
+    void (*clear)(void *impl);
+    peg_state_t (*canonical)(const void *impl, peg_state_t state);
+    int (*solve)(void *impl, peg_state_t state, int *out_moves);
+    int (*solve_to)(void *impl, peg_state_t state, int hole, int *out_moves);
+    peg_count_t (*count)(void *impl, peg_state_t state, peg_state_t *ends);
+    int (*analyze)(void *impl, peg_state_t state, struct peg_move_info *out);
+    int (*open_cache)(void *impl, const char *path);
+    int (*save_cache)(const void *impl, const char *path);
+    void (*set_tt_mb)(void *impl, int tt_mb);
+    int (*set_gpu)(void *impl, int on);
+    void (*tt_stats)(const void *impl, unsigned long *hits, unsigned long *misses);
+    void (*tt_usage)(const void *impl, struct peg_tt_usage *usage);
+};
+
+struct peg_ctx {
+    int n_nodes;
+    int n_jumps;
+    const struct peg_ops *ops;
+    void *impl;
+};
+
+#include "peg-simd.inc"
+#include "peg-opencl.inc"
+#include "peg-mpi.inc"
+
+/* Instantiate everything that works on board states once per state type, so
+ * each board runs on the narrowest type that holds all of its holes */
+#define STATE_T uint32_t
+#define STATE_SUFFIX _32
+#define STATE_HASH(s) hash64(s)
+#define STATE_POPCOUNT(s) __builtin_popcount(s)
+#define STATE_SELECT_KERNELS(e, m) select_kernels_32(e, m)
+#define STATE_SPECIALIZE
+#include "peg-state.inc"
+
+#define STATE_T uint64_t
+#define STATE_SUFFIX _64
+#define STATE_HASH(s) hash64(s)
+#define STATE_POPCOUNT(s) __builtin_popcountll(s)
+#define STATE_SELECT_KERNELS(e, m) select_kernels_64(e, m)
+#define STATE_GPU
+#include "peg-state.inc"
+
+#define STATE_T unsigned __int128
+#define STATE_SUFFIX _128
+#define STATE_HASH(s) hash64((uint64_t)(s) ^ hash64((uint64_t)((s) >> 64)))
+#define STATE_POPCOUNT(s) (__builtin_popcountll((uint64_t)(s)) + __builtin_popcountll((uint64_t)((s) >> 64)))
+#include "peg-state.inc"
+
+/* Returns 1 if state has a peg and no bits beyond the board's holes */
+static int is_board_state(const peg_ctx *ctx, peg_state_t state) {
+    return state != 0 && (state >> ctx->n_nodes) == 0;
+}
+
+/* Builds a context for board g, on the narrowest board state type that holds
+ * every hole */
+static peg_ctx *ctx_create(const struct board_graph *g) {
+    peg_ctx *ctx = malloc(sizeof(peg_ctx));
+    struct jump_nodes jumps[MAX_NODES * MAX_NEIGHBORS];
+
+    ctx->n_nodes = g->n_nodes;
+    ctx->n_jumps = gen_jumps(g, jumps);
+    if (ctx->n_nodes <= 32) {
+        ctx->ops = &ops_32;
+    }
+    else if (ctx->n_nodes <= 64) {
+        ctx->ops = &ops_64;
+    }
+    else {
+        ctx->ops = &ops_128;
+    }
+    ctx->impl = ctx->ops->create(g);
+    return ctx;
+}
+
+peg_ctx *peg_create(int n_rows) {
+    return peg_create_board("triangle", n_rows);
+}
+
+peg_ctx *peg_create_board(const char *board, int size) {
+    struct board_graph g;
+
+    if (board_from_spec(&g, board, size) != 0) {
+        return NULL;
+    }
+    return ctx_create(&g);
+}
+
+void peg_destroy(peg_ctx *ctx) {
+    if (ctx != NULL) {
+        ctx->ops->destroy(ctx->impl);
+        free(ctx);
+    }
+}
+
+int peg_n_nodes(const peg_ctx *ctx) {
+    return ctx->n_nodes;
+}
+
+peg_state_t peg_start_state(const peg_ctx *ctx, int hole) {
+    peg_state_t full = ((peg_state_t)1 << ctx->n_nodes) - 1;
+    return full & ~((peg_state_t)1 << hole);
+}
+
+peg_state_t peg_canonical(const peg_ctx *ctx, peg_state_t state) {
+    return ctx->ops->canonical(ctx->impl, state);
+}
+
+int peg_set_threads(peg_ctx *ctx, int n_threads) {
+    if (n_threads < 1) {
+        return -1;
+    }
+    ctx->ops->set_threads(ctx->impl, n_threads);
+    return 0;
+}
+
+int peg_set_move_order(peg_ctx *ctx, int order) {
+    if (order < 0 || order >= PEG_N_ORDERS) {
+        return -1;
+    }
+    ctx->ops->set_move_order(ctx->impl, order);
+    return 0;
+}
+
+int peg_move_order_from_name(const char *name) {
+    for (int i = 0; i < PEG_N_ORDERS; i++) {
+        if (strcmp(name, move_order_names[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int peg_open_db(peg_ctx *ctx, const char *path) {
+    if (ctx->n_nodes > DB_MAX_NODES) {
+        return -1;
+    }
+    return ctx->ops->open_db(ctx->impl, path);
+}
+
+void peg_clear(peg_ctx *ctx) {
+    ctx->ops->clear(ctx->impl);
+}
+
+int peg_solve(peg_ctx *ctx, peg_state_t state, int *out_moves) {
+    if (!is_board_state(ctx, state)) {
+        return -1;
+    }
+    return ctx->ops->solve(ctx->impl, state, out_moves);
+}
+
+int peg_solve_to(peg_ctx *ctx, peg_state_t state, int hole, int *out_moves) {
+    if (!is_board_state(ctx, state) || hole < 0 || hole >= ctx->n_nodes) {
+        return -1;
+    }
+    return ctx->ops->solve_to(ctx->impl, state, hole, out_moves);
+}
+
+peg_count_t peg_count(peg_ctx *ctx, peg_state_t state, peg_state_t *ends) {
+    if (!is_board_state(ctx, state)) {
+        if (ends != NULL) {
+            *ends = 0;
+        }
+        return 0;
+    }
+    return ctx->ops->count(ctx->impl, state, ends);
+}
+
+int peg_max_moves(const peg_ctx *ctx) {
+    return ctx->n_jumps;
+}
+
+int peg_analyze(peg_ctx *ctx, peg_state_t state, struct peg_move_info *out) {
+    if (!is_board_state(ctx, state)) {
+        return -1;
+    }
+    return ctx->ops->analyze(ctx->impl, state, out);
+}
+
+int peg_open_cache(peg_ctx *ctx, const char *path) {
+    return ctx->ops->open_cache(ctx->impl, path);
+}
+
+int peg_save_cache(const peg_ctx *ctx, const char *path) {
+    return ctx->ops->save_cache(ctx->impl, path);
+}
+
+int peg_set_tt_mb(peg_ctx *ctx, int tt_mb) {
+    if (tt_mb < 1) {
+        return -1;
+    }
+    ctx->ops->set_tt_mb(ctx->impl, tt_mb);
+    return 0;
+}
+
+int peg_set_gpu(peg_ctx *ctx, int on) {
+    return ctx->ops->set_gpu(ctx->impl, on);
+}
+
+void peg_tt_stats(const peg_ctx *ctx, unsigned long *hits, unsigned long *misses) {
+    ctx->ops->tt_stats(ctx->impl, hits, misses);
+}
+
+void peg_tt_usage(const peg_ctx *ctx, struct peg_tt_usage *usage) {
+    ctx->ops->tt_usage(ctx->impl, usage);
+}
+
+void peg_decode_move(int move, int *src, int *mid, int *dest) {
+    dec_move(move, src, mid, dest);
+}
+
+int peg_run(const struct peg_options *opt) {
+    const char *spec = opt->board ? opt->board : "triangle";
+    int n_nodes;
+    struct board_graph g;
+
+    if ((opt->board == NULL && (opt->n_rows < MIN_ROWS || opt->n_rows > MAX_ROWS)) || opt->n_threads < 1 ||
+        opt->move_order < 0 || opt->move_order >= PEG_N_ORDERS || opt->output < 0 || opt->output >= PEG_N_OUTPUTS ||
+        opt->tt_mb < 0 || opt->mem_mb < 0 || opt->checkpoint_secs < 0) {
+        fprintf(stderr, "Error: Argument invalid.\n");
+        return 1;
+    }
+    if (board_from_spec(&g, spec, opt->n_rows) != 0) {
+        fprintf(stderr, "Error: %s is not a supported board.\n", spec);
+        return 1;
+    }
+
+    n_nodes = g.n_nodes;
+    if (opt->output == PEG_OUTPUT_BINARY && !opt->serve) {
+        fprintf(stderr, "Error: Binary output is only for --serve.\n");
+        return 1;
+    }
+    if (opt->finish && (opt->finish_hole < PEG_FINISH_START || opt->finish_hole >= n_nodes)) {
+        fprintf(stderr, "Error: The board has no hole %d.\n", opt->finish_hole);
+        return 1;
+    }
+    if (opt->distributed && !opt->bfs_mode) {
+        fprintf(stderr, "Error: --distributed is only for --bfs.\n");
+        return 1;
+    }
+    if (opt->checkpoint_path && (opt->finish || opt->serve || opt->db_path)) {
+        fprintf(stderr, "Error: --checkpoint is only for solving, --count and --bfs.\n");
+        return 1;
+    }
+    if (opt->distributed && !DIST_ENABLED) {
+        fprintf(stderr, "Error: --distributed needs a build with PEG_MPI.\n");
+        return 1;
+    }
+    if (opt->resume && !opt->checkpoint_path) {
+        fprintf(stderr, "Error: --resume needs --checkpoint.\n");
+        return 1;
+    }
+    if (opt->db_path && n_nodes > DB_MAX_NODES) {
+        fprintf(stderr, "Error: Endgame databases are limited to %d holes.\n", DB_MAX_NODES);
+        return 1;
+    }
+
+    if (opt->stats_json) {
+        fprintf(opt->stats_json, "{\n  \"rows\": %d,\n  \"threads\": %d,\n  \"counters\": %s,\n  \"starts\": [",
+                g.n_rows, opt->n_threads, STATS_ENABLED ? "true" : "false");
+    }
+
+    /* Pick the narrowest board state type that holds every hole */
+    if (n_nodes <= 32) {
+        run_32(opt, &g);
+    }
+    else if (n_nodes <= 64) {
+        run_64(opt, &g);
+    }
+    else {
+        run_128(opt, &g);
+    }
+
+    if (opt->stats_json) {
+        fprintf(opt->stats_json, "\n  ]\n}\n");
+    }
+    return 0;
+}
+#endif
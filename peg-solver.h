@@ -0,0 +1,213 @@
+/******************************************************************************
+* peg-solver.h
+* C API of libpegsolver, the solver behind peg-game-solver. A context holds
+* everything built for one board (its jump table, symmetries, transposition
+* table and counting memo), so repeated queries skip the setup and reuse the
+* dead states and counts found by earlier ones. A context must not be used
+* by more than one thread at a time; peg_set_threads() lets its searches use
+* several.
+*
+* Board states have bit i set if hole i holds a peg, with holes numbered
+* from top to bottom, left to right. Besides the triangles of the original
+* game, boards can be hexagons, the English and European crosses, or any
+* shape read from a board file (see peg-board.inc for the format).
+*/
+
+#ifndef PEG_SOLVER_H
+#define PEG_SOLVER_H
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PEG_MIN_ROWS 4
+#define PEG_MAX_ROWS 15
+#define PEG_MAX_NODES 120           /* Holes of a PEG_MAX_ROWS triangle, and of any board */
+
+/* A board state of any supported board */
+typedef unsigned __int128 peg_state_t;
+
+/* Number of move sequences, which outgrows 64 bits on large boards */
+typedef unsigned __int128 peg_count_t;
+
+typedef struct peg_ctx peg_ctx;
+
+/* Builds a context for a triangle of n_rows rows. Returns NULL if the board
+ * is not supported. */
+peg_ctx *peg_create(int n_rows);
+
+/* Builds a context for the board named by board: "triangle" with size rows,
+ * "hex" with size holes on each side, "english", "european", or the path of
+ * a board file. Returns NULL if there is no such board or it has more than
+ * PEG_MAX_NODES holes. */
+peg_ctx *peg_create_board(const char *board, int size);
+void peg_destroy(peg_ctx *ctx);
+
+int peg_n_nodes(const peg_ctx *ctx);
+
+/* The full board with one hole */
+peg_state_t peg_start_state(const peg_ctx *ctx, int hole);
+
+/* The least of the states the board's rotations and reflections take the
+ * state to. States with the same canonical state play out alike. */
+peg_state_t peg_canonical(const peg_ctx *ctx, peg_state_t state);
+
+/* Searches with n_threads threads from now on. Returns 0, or -1 if
+ * n_threads is less than 1. */
+int peg_set_threads(peg_ctx *ctx, int n_threads);
+
+/* How peg_solve() orders the legal moves of each state it searches */
+enum peg_move_order {
+    PEG_ORDER_TABLE,                /* By jumping peg, as the jump table lists them */
+    PEG_ORDER_CENTER,               /* Landing farthest from the edge of the board first */
+    PEG_ORDER_ISOLATED,             /* Leaving the fewest pegs without a neighbor first */
+    PEG_ORDER_HISTORY,              /* Played most on the deepest lines found so far first */
+    PEG_N_ORDERS
+};
+
+/* Orders moves as order says from now on. Returns 0, or -1 if order is not
+ * an enum peg_move_order. */
+int peg_set_move_order(peg_ctx *ctx, int order);
+
+/* The enum peg_move_order named by name ("table", "center", "isolated" or
+ * "history"), or -1 if there is none */
+int peg_move_order_from_name(const char *name);
+
+/* Answers peg_solve() from the endgame database at path from now on (see
+ * peg-game-solver --build-db). Returns 0, or -1 if it cannot be used. */
+int peg_open_db(peg_ctx *ctx, const char *path);
+
+/* Forgets the dead states and counts found so far */
+void peg_clear(peg_ctx *ctx);
+
+/* Finds a way to reduce state to a single peg. Writes its moves to out_moves
+ * (if not NULL), which needs room for peg_n_nodes() entries, and returns how
+ * many there are. Returns -1 if there is none or state is not a board state
+ * with at least one peg. */
+int peg_solve(peg_ctx *ctx, peg_state_t state, int *out_moves);
+
+/* Finds a way to reduce state to a single peg in hole, searching breadth
+ * first from both ends at once. That takes memory for every distinct state
+ * either end reaches up to the middle, but far less than one end would need
+ * to get all the way. Writes the moves as peg_solve() does, and returns how
+ * many there are, or -1 if there is no way or the arguments are invalid. */
+int peg_solve_to(peg_ctx *ctx, peg_state_t state, int hole, int *out_moves);
+
+/* Counts the move sequences that reduce state to a single peg, and sets
+ * *ends (if not NULL) to the holes that peg can finish in */
+peg_count_t peg_count(peg_ctx *ctx, peg_state_t state, peg_state_t *ends);
+
+/* A legal move of a state, with what peg_count() would say of the state it
+ * leads to */
+struct peg_move_info {
+    int move;                       /* As peg_decode_move() splits it */
+    int solvable;                   /* The state can still be reduced to a single peg */
+    peg_count_t n_solutions;        /* Move sequences that do so */
+    peg_state_t ends;               /* Holes the last peg can finish in */
+};
+
+/* The most legal moves any state of the board can have: one per jump */
+int peg_max_moves(const peg_ctx *ctx);
+
+/* Rates every legal move of state in one pass, sharing the counting memo
+ * with peg_count(): the first call on a board counts the states below it,
+ * and later ones mostly read the memo. Moves the endgame database (see
+ * peg_open_db()) finds unsolvable are not counted. Writes the moves to out,
+ * which needs room for peg_max_moves() entries, in the order the jump table
+ * lists them, and returns how many there are, or -1 if state is not a board
+ * state with at least one peg. */
+int peg_analyze(peg_ctx *ctx, peg_state_t state, struct peg_move_info *out);
+
+/* Loads the dead states found by earlier runs from the cache at path (see
+ * peg_save_cache()), mapping the file rather than reading it. Returns 1 if
+ * it held states for this board, or 0 if there was nothing to load, which
+ * leaves the context as it was. */
+int peg_open_cache(peg_ctx *ctx, const char *path);
+
+/* Writes the dead states found so far to the cache at path, replacing it
+ * atomically. Returns 0, or -1 if it could not be written. */
+int peg_save_cache(const peg_ctx *ctx, const char *path);
+
+/* Caps the transposition table of boards over 21 holes, and the counting
+ * memo, at about tt_mb MiB (256 by default). A full table gives up the dead
+ * states with the fewest pegs, which are the quickest to search again. This
+ * forgets the dead states and counts found so far. Returns 0, or -1 if tt_mb
+ * is less than 1. */
+int peg_set_tt_mb(peg_ctx *ctx, int tt_mb);
+
+/* Expands the layers of peg_solve_to() on an OpenCL device from now on if on
+ * is not 0, or on the CPU if it is. Returns 0, or -1 if the library was built
+ * without PEG_OPENCL, there is no device, or the board does not have 33 to 64
+ * holes; the CPU is used then. The kernels are untested on real devices:
+ * they have only been run on a host emulation of OpenCL. */
+int peg_set_gpu(peg_ctx *ctx, int on);
+
+/* The transposition table probes of the searches so far */
+void peg_tt_stats(const peg_ctx *ctx, unsigned long *hits, unsigned long *misses);
+
+/* How full the transposition table is */
+struct peg_tt_usage {
+    unsigned long used;             /* Dead states held */
+    unsigned long capacity;         /* Dead states it has room for */
+    unsigned long evictions;        /* Dead states given up for others */
+    unsigned long drops;            /* Dead states not kept for lack of room */
+};
+
+void peg_tt_usage(const peg_ctx *ctx, struct peg_tt_usage *usage);
+
+/* Splits a move from out_moves into the jumping peg, the peg it removes and
+ * the hole it lands in */
+void peg_decode_move(int move, int *src, int *mid, int *dest);
+
+/* How peg-game-solver writes its results */
+enum peg_output {
+    PEG_OUTPUT_TEXT,
+    PEG_OUTPUT_BINARY,              /* Varint records, for --serve (see peg-state.inc) */
+    PEG_N_OUTPUTS
+};
+
+/* finish_hole of struct peg_options for the hole each start begins empty */
+#define PEG_FINISH_START -1
+
+/* What peg-game-solver's command line asked for */
+struct peg_options {
+    int n_rows;
+    int n_threads;
+    int count_mode;
+    int bfs_mode;                   /* Search breadth first by peg count */
+    int stats;                      /* Report on each search (--stats) */
+    FILE *stats_json;               /* If not NULL, write the reports here too */
+    const char *db_path;            /* Endgame database to build or solve with */
+    int build_db;
+    int serve;                      /* Answer board states read from stdin */
+    int move_order;                 /* An enum peg_move_order */
+    const char *board;              /* As for peg_create_board(), with n_rows as its size,
+                                     * or NULL for a triangle of n_rows */
+    int finish;                     /* Search for a last peg in finish_hole (--finish) */
+    int finish_hole;                /* A hole, or PEG_FINISH_START */
+    int output;                     /* An enum peg_output (--format) */
+    int quiet;                      /* Leave out the board dumps (--quiet) */
+    const char *cache_path;         /* Transposition table cache to load and update (--cache) */
+    int tt_mb;                      /* Cap in MiB on the transposition table (--tt-mb), or 0 */
+    int mem_mb;                     /* Cap in MiB on the layers of --bfs and --finish and on
+                                     * --build-db (--mem-mb), or 0 for the machine's memory */
+    int gpu;                        /* Expand the layers of --bfs and --finish on a GPU (--gpu) */
+    int distributed;                /* Share --bfs among the ranks of an MPI job (--distributed) */
+    const char *checkpoint_path;    /* Save the progress of the search in files starting with this
+                                     * (--checkpoint) */
+    int resume;                     /* Start from the progress saved there (--resume) */
+    int checkpoint_secs;            /* Seconds between the checkpoints of solving and --count
+                                     * (--checkpoint-secs), or 0 */
+};
+
+/* Runs the command line front end, printing to stdout. Returns 0, or prints
+ * an error and returns 1. */
+int peg_run(const struct peg_options *opt);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PEG_SOLVER_H */
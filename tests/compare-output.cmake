@@ -0,0 +1,20 @@
+# Runs SOLVER and OTHER with the arguments ARGS (a list) and fails unless both
+# succeed and print the same output. ctest runs it with cmake -P.
+
+foreach(solver SOLVER OTHER)
+    execute_process(COMMAND ${${solver}} ${ARGS}
+        OUTPUT_VARIABLE output_${solver}
+        RESULT_VARIABLE result_${solver}
+        )
+    if(NOT result_${solver} EQUAL 0)
+        message(FATAL_ERROR "${${solver}} exited with ${result_${solver}}")
+    endif()
+endforeach()
+
+string(REPLACE ";" " " command_line "${ARGS}")
+if(NOT output_SOLVER STREQUAL output_OTHER)
+    file(WRITE ${CMAKE_CURRENT_BINARY_DIR}/solver.out "${output_SOLVER}")
+    file(WRITE ${CMAKE_CURRENT_BINARY_DIR}/other.out "${output_OTHER}")
+    message(FATAL_ERROR "${SOLVER} and ${OTHER} differ on ${command_line}; "
+        "see solver.out and other.out in ${CMAKE_CURRENT_BINARY_DIR}")
+endif()